@@ -18,6 +18,8 @@
  */
 
 #include <string.h>
+#include <math.h>
+#include <gst/video/video.h>
 #include "gst-rtsp-cam-media-factory.h"
 
 #define DEFAULT_LOCATION NULL
@@ -34,10 +36,16 @@ enum
   PROP_VIDEO_FRAMERATE,
   PROP_VIDEO_CODEC,
   PROP_VIDEO_CODEC_OPTIONS,
+  PROP_VIDEO_CODEC_AUTOTUNE,
+  PROP_VIDEO_CODEC_HEADROOM,
+  PROP_VIDEO_EXPORT,
+  PROP_VIDEO_EXPORT_SLOTS,
   PROP_AUDIO,
   PROP_AUDIO_DEVICE,
   PROP_AUDIO_CODEC,
-  PROP_AUDIO_CODEC_OPTIONS
+  PROP_AUDIO_CODEC_OPTIONS,
+  PROP_MOSAIC_DEVICES,
+  PROP_MOSAIC_COLUMNS
 };
 
 enum
@@ -49,8 +57,86 @@ typedef struct
 {
   gchar *name;
   gchar *bin;
+  /* encoder settings tried by autotune, from best quality to fastest */
+  gchar **presets;
+  /* whether the encoder applies a new preset while running */
+  gboolean live_presets;
 } CodecDescriptor;
 
+/* measures how long the encoder spends on each frame. Encoders push from
+ * within their chain function, so the time from a buffer entering the encoder
+ * to the next buffer leaving it is the time it took to encode. */
+typedef struct
+{
+  GstClockTime start;
+  GstClockTime total;
+  guint samples;
+} EncodeTimer;
+
+/* measures how fast the encoder outputs frames once it's past its initial
+ * delay. Encoders like x264 hold frames back for lookahead and frame threads,
+ * so the time spent in a single chain call says little about throughput.
+ * Frames flushed at EOS come out without waiting for input and aren't
+ * counted. */
+typedef struct
+{
+  GstClockTime first;
+  GstClockTime last;
+  guint frames;
+  gboolean eos;
+} EncodeRate;
+
+/* watches the encoder of a media to step the preset down when it can't keep
+ * up */
+typedef struct
+{
+  EncodeTimer timer;
+  GstRTSPCamMediaFactory *factory;
+  GstRTSPMedia *media;
+  GstElement *encoder;
+  CodecDescriptor *codec;
+  gint preset;
+  GstClockTime budget;
+  guint window;
+  guint overloaded;
+  gboolean stopped;
+} EncoderMonitor;
+
+/* a cell of the mosaic grid, holding the last frame received from its camera */
+typedef struct
+{
+  GMutex *lock;
+  GstBuffer *buffer;
+  GstElement *bin;
+  gint x;
+  gint y;
+  gint width;
+  gint height;
+} MosaicTile;
+
+typedef struct
+{
+  gint width;
+  gint height;
+  guint n_tiles;
+  MosaicTile *tiles;
+  guint retry_source;
+} Mosaic;
+
+/* holds the elements of a single mosaic camera and swallows their errors, so
+ * that a dead camera leaves its tile black or frozen on its last frame instead
+ * of taking the whole mosaic down */
+typedef struct
+{
+  GstBin bin;
+  volatile gint failed;
+} MosaicTileBin;
+
+typedef struct
+{
+  GstBinClass klass;
+} MosaicTileBinClass;
+
 GST_DEBUG_CATEGORY_STATIC (rtsp_cam_media_factory_debug);
 #define GST_CAT_DEFAULT rtsp_cam_media_factory_debug
 
@@ -62,8 +148,11 @@ static void gst_rtsp_cam_media_factory_finalize (GObject * obj);
 static GstElement * gst_rtsp_cam_media_factory_get_element (GstRTSPMediaFactory *factory,
     const GstRTSPUrl *url);
 static gchar *gst_rtsp_cam_media_factory_gen_key (GstRTSPMediaFactory *factory, const GstRTSPUrl *url);
+static void gst_rtsp_cam_media_factory_configure (GstRTSPMediaFactory *factory,
+    GstRTSPMedia *media);
 
 G_DEFINE_TYPE (GstRTSPCamMediaFactory, gst_rtsp_cam_media_factory, GST_TYPE_RTSP_MEDIA_FACTORY);
+G_DEFINE_TYPE (MosaicTileBin, mosaic_tile_bin, GST_TYPE_BIN);
   
 #define DEFAULT_VIDEO TRUE
 #define DEFAULT_VIDEO_DEVICE NULL
@@ -73,19 +162,60 @@ G_DEFINE_TYPE (GstRTSPCamMediaFactory, gst_rtsp_cam_media_factory, GST_TYPE_RTSP
 #define DEFAULT_VIDEO_FRAMERATE_D 1
 #define DEFAULT_VIDEO_CODEC "theora"
 #define DEFAULT_VIDEO_CODEC_OPTIONS ""
+#define DEFAULT_VIDEO_CODEC_AUTOTUNE FALSE
+#define DEFAULT_VIDEO_CODEC_HEADROOM 20
+#define DEFAULT_VIDEO_EXPORT NULL
+#define DEFAULT_VIDEO_EXPORT_SLOTS 4
 #define DEFAULT_AUDIO TRUE
 #define DEFAULT_AUDIO_DEVICE NULL
 #define DEFAULT_AUDIO_CODEC "vorbis"
 #define DEFAULT_AUDIO_CODEC_OPTIONS ""
+#define DEFAULT_MOSAIC_DEVICES NULL
+#define DEFAULT_MOSAIC_COLUMNS 0
+#define DEFAULT_MOSAIC_WIDTH 640
+#define DEFAULT_MOSAIC_HEIGHT 480
+#define DEFAULT_MOSAIC_FRAMERATE_N 25
+#define DEFAULT_MOSAIC_FRAMERATE_D 1
+/* how often failed mosaic cameras are restarted */
+#define MOSAIC_RETRY_SECONDS 5
+
+#define CALIBRATION_WIDTH 640
+#define CALIBRATION_HEIGHT 480
+#define CALIBRATION_FRAMERATE_N 25
+#define CALIBRATION_FRAMERATE_D 1
+#define CALIBRATION_SECONDS 2
+/* more than the frames encoders hold back before their first output, x264
+ * medium has a lookahead of 40 plus its frame threads */
+#define CALIBRATION_DELAY_FRAMES 100
+#define CALIBRATION_TIMEOUT (30 * GST_SECOND)
+/* how long to wait before restarting a kept alive media that stopped */
+#define KEEP_ALIVE_RETRY_SECONDS 5
+/* consecutive overloaded seconds before stepping the preset down */
+#define OVERLOAD_WINDOWS 3
+
+static gchar *theora_presets[] = {
+  "speed-level=0", "speed-level=1", "speed-level=2", NULL
+};
+
+static gchar *h264_presets[] = {
+  "speed-preset=medium", "speed-preset=fast", "speed-preset=faster",
+  "speed-preset=veryfast", "speed-preset=superfast", "speed-preset=ultrafast",
+  NULL
+};
+
+static gchar *vp8_presets[] = {
+  "speed=0", "speed=1", "speed=2", NULL
+};
 
 static CodecDescriptor codecs[] = {
-  { "theora", "theoraenc %s ! rtptheorapay name=pay%d pt=96" },
-  { "h264", "x264enc %s ! rtph264pay name=pay%d pt=96" },
-  { "mp3", "lame %s ! rtpmpapay name=pay%d pt=97" },
-  { "vp8", "vp8enc %s ! rtpvp8pay name=pay%d pt=96" },
-  { "vorbis", "vorbisenc %s ! rtpvorbispay name=pay%d pt=97" },
-  { "amrnb", "amrnbenc %s ! rtpamrpay name=pay%d pt=97" },
-  { NULL, NULL }
+  { "theora", "theoraenc %s ! rtptheorapay name=pay%d pt=96", theora_presets, FALSE },
+  { "h264", "x264enc %s ! rtph264pay name=pay%d pt=96", h264_presets, FALSE },
+  { "mp3", "lame %s ! rtpmpapay name=pay%d pt=97", NULL, FALSE },
+  /* vp8enc passes the speed as the deadline of every frame it encodes */
+  { "vp8", "vp8enc %s ! rtpvp8pay name=pay%d pt=96", vp8_presets, TRUE },
+  { "vorbis", "vorbisenc %s ! rtpvorbispay name=pay%d pt=97", NULL, FALSE },
+  { "amrnb", "amrnbenc %s ! rtpamrpay name=pay%d pt=97", NULL, FALSE },
+  { NULL, NULL, NULL, FALSE }
 };
 
 static void
@@ -102,6 +232,7 @@ gst_rtsp_cam_media_factory_class_init (GstRTSPCamMediaFactoryClass * klass)
 
   media_factory_class->get_element = gst_rtsp_cam_media_factory_get_element;
   media_factory_class->gen_key = gst_rtsp_cam_media_factory_gen_key;
+  media_factory_class->configure = gst_rtsp_cam_media_factory_configure;
 
   g_object_class_install_property (gobject_class, PROP_VIDEO,
       g_param_spec_boolean ("video", "Video", "video",
@@ -120,6 +251,29 @@ gst_rtsp_cam_media_factory_class_init (GstRTSPCamMediaFactoryClass * klass)
           "video codec options", DEFAULT_VIDEO_CODEC,
           G_PARAM_READWRITE | G_PARAM_CONSTRUCT));
 
+  g_object_class_install_property (gobject_class, PROP_VIDEO_CODEC_AUTOTUNE,
+      g_param_spec_boolean ("video-codec-autotune", "Video codec autotune",
+          "pick the video codec preset that sustains the frame rate",
+          DEFAULT_VIDEO_CODEC_AUTOTUNE, G_PARAM_READWRITE | G_PARAM_CONSTRUCT));
+
+  g_object_class_install_property (gobject_class, PROP_VIDEO_CODEC_HEADROOM,
+      g_param_spec_int ("video-codec-headroom", "Video codec headroom",
+          "percentage of each frame interval autotune keeps free",
+          0, 99, DEFAULT_VIDEO_CODEC_HEADROOM,
+          G_PARAM_READWRITE | G_PARAM_CONSTRUCT));
+
+  g_object_class_install_property (gobject_class, PROP_VIDEO_EXPORT,
+      g_param_spec_string ("video-export", "Video export",
+          "name of the shared memory to export raw video frames to",
+          DEFAULT_VIDEO_EXPORT, G_PARAM_READWRITE | G_PARAM_CONSTRUCT));
+
+  g_object_class_install_property (gobject_class, PROP_VIDEO_EXPORT_SLOTS,
+      g_param_spec_int ("video-export-slots", "Video export slots",
+          "number of frames kept in the shared memory export, rounded up "
+          "to a power of two",
+          2, G_MAXINT32, DEFAULT_VIDEO_EXPORT_SLOTS,
+          G_PARAM_READWRITE | G_PARAM_CONSTRUCT));
+
   g_object_class_install_property (gobject_class, PROP_VIDEO_WIDTH,
       g_param_spec_int ("video-width", "Video width", "video width",
           -1, G_MAXINT32, DEFAULT_VIDEO_WIDTH, G_PARAM_READWRITE | G_PARAM_CONSTRUCT));
@@ -151,6 +305,18 @@ gst_rtsp_cam_media_factory_class_init (GstRTSPCamMediaFactoryClass * klass)
           "audio codec options", DEFAULT_AUDIO_CODEC,
           G_PARAM_READWRITE | G_PARAM_CONSTRUCT));
 
+  g_object_class_install_property (gobject_class, PROP_MOSAIC_DEVICES,
+      g_param_spec_string ("mosaic-devices", "Mosaic devices",
+          "comma separated list of video devices or URIs, for example the "
+          "rtsp:// mounts of other servers, to composite in a grid",
+          DEFAULT_MOSAIC_DEVICES, G_PARAM_READWRITE | G_PARAM_CONSTRUCT));
+
+  g_object_class_install_property (gobject_class, PROP_MOSAIC_COLUMNS,
+      g_param_spec_int ("mosaic-columns", "Mosaic columns",
+          "number of columns of the mosaic grid (0 = automatic)",
+          0, G_MAXINT32, DEFAULT_MOSAIC_COLUMNS,
+          G_PARAM_READWRITE | G_PARAM_CONSTRUCT));
+
   GST_DEBUG_CATEGORY_INIT (rtsp_cam_media_factory_debug,
       "rtspcammediafactory", 0, "RTSP Cam Media Factory");
 }
@@ -160,6 +326,9 @@ gst_rtsp_cam_media_factory_init (GstRTSPCamMediaFactory * factory)
 {
   gst_rtsp_media_factory_set_shared (GST_RTSP_MEDIA_FACTORY (factory),
       TRUE);
+
+  factory->video_codec_preset = -1;
+  factory->video_export_lock = g_mutex_new ();
 }
 
 static void
@@ -169,8 +338,17 @@ gst_rtsp_cam_media_factory_finalize (GObject * obj)
 
   g_free (factory->video_device);
   g_free (factory->video_codec);
+  g_free (factory->video_export);
+  if (factory->video_export_writer)
+    gst_rtsp_cam_shm_writer_free (factory->video_export_writer);
+  g_mutex_free (factory->video_export_lock);
+  if (factory->keep_alive_media)
+    g_object_unref (factory->keep_alive_media);
+  if (factory->keep_alive_url)
+    gst_rtsp_url_free (factory->keep_alive_url);
   g_free (factory->audio_device);
   g_free (factory->audio_codec);
+  g_free (factory->mosaic_devices);
 
   G_OBJECT_CLASS (gst_rtsp_cam_media_factory_parent_class)->finalize (obj);
 }
@@ -206,6 +384,18 @@ gst_rtsp_cam_media_factory_get_property (GObject *object, guint propid,
     case PROP_VIDEO_CODEC_OPTIONS:
       g_value_set_string (value, factory->video_codec_options);
       break;
+    case PROP_VIDEO_CODEC_AUTOTUNE:
+      g_value_set_boolean (value, factory->video_codec_autotune);
+      break;
+    case PROP_VIDEO_CODEC_HEADROOM:
+      g_value_set_int (value, factory->video_codec_headroom);
+      break;
+    case PROP_VIDEO_EXPORT:
+      g_value_set_string (value, factory->video_export);
+      break;
+    case PROP_VIDEO_EXPORT_SLOTS:
+      g_value_set_int (value, factory->video_export_slots);
+      break;
     case PROP_AUDIO_DEVICE:
       g_value_set_string (value, factory->audio_device);
       break;
@@ -215,6 +405,12 @@ gst_rtsp_cam_media_factory_get_property (GObject *object, guint propid,
     case PROP_AUDIO_CODEC_OPTIONS:
       g_value_set_string (value, factory->audio_codec_options);
       break;
+    case PROP_MOSAIC_DEVICES:
+      g_value_set_string (value, factory->mosaic_devices);
+      break;
+    case PROP_MOSAIC_COLUMNS:
+      g_value_set_int (value, factory->mosaic_columns);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, propid, pspec);
   }
@@ -261,6 +457,19 @@ gst_rtsp_cam_media_factory_set_property (GObject *object, guint propid,
       if (factory->video_codec_options == NULL)
         factory->video_codec_options = g_strdup (DEFAULT_VIDEO_CODEC_OPTIONS);
       break;
+    case PROP_VIDEO_CODEC_AUTOTUNE:
+      factory->video_codec_autotune = g_value_get_boolean (value);
+      break;
+    case PROP_VIDEO_CODEC_HEADROOM:
+      factory->video_codec_headroom = g_value_get_int (value);
+      break;
+    case PROP_VIDEO_EXPORT:
+      g_free (factory->video_export);
+      factory->video_export = g_value_dup_string (value);
+      break;
+    case PROP_VIDEO_EXPORT_SLOTS:
+      factory->video_export_slots = g_value_get_int (value);
+      break;
     case PROP_AUDIO_DEVICE:
       g_free (factory->audio_device);
       factory->audio_device = g_value_dup_string (value);
@@ -279,6 +488,13 @@ gst_rtsp_cam_media_factory_set_property (GObject *object, guint propid,
       if (factory->audio_codec_options == NULL)
         factory->audio_codec_options = g_strdup (DEFAULT_AUDIO_CODEC_OPTIONS);
       break;
+    case PROP_MOSAIC_DEVICES:
+      g_free (factory->mosaic_devices);
+      factory->mosaic_devices = g_value_dup_string (value);
+      break;
+    case PROP_MOSAIC_COLUMNS:
+      factory->mosaic_columns = g_value_get_int (value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, propid, pspec);
   }
@@ -309,15 +525,33 @@ find_codec (GstRTSPCamMediaFactory *factory, gchar *codec_name)
   return NULL;
 }
 
+/* the codec options with commas turned into spaces, preceded by preset so
+ * that options explicitly set by the user win over it */
+static gchar *
+build_codec_options (gchar *codec_options, const gchar *preset)
+{
+  gint i;
+
+  for (i = 0; i < strlen(codec_options); i++)
+    if (codec_options[i] == ',') codec_options[i] = ' ';
+
+  if (preset == NULL)
+    return g_strdup (codec_options);
+
+  return g_strdup_printf ("%s %s", preset, codec_options);
+}
+
 static GstElement *
 create_payloader (GstRTSPCamMediaFactory *factory,
-    gchar *codec_name, gchar *codec_options, gint payloader_number)
+    gchar *codec_name, gchar *codec_options, const gchar *preset,
+    gint payloader_number)
 {
   CodecDescriptor *codec;
   GstElement *bin;
+  GError *error = NULL;
+  gchar *options;
   gchar *description;
   gchar *name;
-  gint i;
 
   codec = find_codec (factory, codec_name);
   if (codec == NULL) {
@@ -326,12 +560,21 @@ create_payloader (GstRTSPCamMediaFactory *factory,
     return NULL;
   }
 
-  for (i = 0; i < strlen(codec_options); i++)
-    if (codec_options[i] == ',') codec_options[i] = ' ';
-
-  description = g_strdup_printf (codec->bin, codec_options, payloader_number);
+  options = build_codec_options (codec_options, preset);
+  description = g_strdup_printf (codec->bin, options, payloader_number);
+  g_free (options);
   GST_DEBUG_OBJECT (factory, "creating bin %s", codec->bin);
-  bin = gst_parse_bin_from_description (description, TRUE, NULL);
+  bin = gst_parse_bin_from_description (description, TRUE, &error);
+  if (error != NULL) {
+    GST_ERROR_OBJECT (factory, "couldn't create %s: %s", description,
+        error->message);
+    g_error_free (error);
+    g_free (description);
+    if (bin)
+      gst_object_unref (bin);
+
+    return NULL;
+  }
   g_free (description);
 
   name = g_strdup_printf ("pay%d", payloader_number);
@@ -341,6 +584,921 @@ create_payloader (GstRTSPCamMediaFactory *factory,
   return bin;
 }
 
+static const gchar *
+get_video_codec_preset (GstRTSPCamMediaFactory *factory)
+{
+  CodecDescriptor *codec;
+  gint preset;
+
+  if (!factory->video_codec_autotune)
+    return NULL;
+
+  codec = find_codec (factory, factory->video_codec);
+  preset = g_atomic_int_get (&factory->video_codec_preset);
+  if (codec == NULL || codec->presets == NULL || preset < 0)
+    return NULL;
+
+  return codec->presets[preset];
+}
+
+/* Gets the size and frame rate the video encoder runs at, which is what
+ * autotune calibrates for. Returns FALSE when they aren't configured and the
+ * returned values are the ones assumed instead. A mosaic is always encoded at
+ * a known size and frame rate. */
+gboolean
+gst_rtsp_cam_media_factory_get_video_format (GstRTSPCamMediaFactory *factory,
+    gint *width, gint *height, gint *fps_n, gint *fps_d)
+{
+  gboolean mosaic = factory->mosaic_devices && *factory->mosaic_devices;
+  gboolean configured = TRUE;
+
+  if (factory->video_width != -1) {
+    *width = factory->video_width;
+  } else {
+    *width = mosaic ? DEFAULT_MOSAIC_WIDTH : CALIBRATION_WIDTH;
+    configured = mosaic;
+  }
+
+  if (factory->video_height != -1) {
+    *height = factory->video_height;
+  } else {
+    *height = mosaic ? DEFAULT_MOSAIC_HEIGHT : CALIBRATION_HEIGHT;
+    configured = mosaic;
+  }
+
+  if (factory->fps_n != 0 && factory->fps_d != 0) {
+    *fps_n = factory->fps_n;
+    *fps_d = factory->fps_d;
+  } else {
+    *fps_n = mosaic ? DEFAULT_MOSAIC_FRAMERATE_N : CALIBRATION_FRAMERATE_N;
+    *fps_d = mosaic ? DEFAULT_MOSAIC_FRAMERATE_D : CALIBRATION_FRAMERATE_D;
+    configured = mosaic;
+  }
+
+  return configured;
+}
+
+/* the encoder inside a bin made by create_payloader, owned by the bin */
+static GstElement *
+get_encoder (GstElement *pay)
+{
+  GstElement *encoder;
+  GstPad *ghost, *target;
+
+  ghost = gst_element_get_static_pad (pay, "sink");
+  target = gst_ghost_pad_get_target (GST_GHOST_PAD (ghost));
+  gst_object_unref (ghost);
+  if (target == NULL)
+    return NULL;
+
+  encoder = gst_pad_get_parent_element (target);
+  gst_object_unref (target);
+  if (encoder)
+    gst_object_unref (encoder);
+
+  return encoder;
+}
+
+static gboolean
+encode_timer_sink_probe (GstPad *pad, GstBuffer *buffer, EncodeTimer *timer)
+{
+  timer->start = gst_util_get_timestamp ();
+
+  return TRUE;
+}
+
+static gboolean
+encode_timer_src_probe (GstPad *pad, GstBuffer *buffer, EncodeTimer *timer)
+{
+  if (!GST_CLOCK_TIME_IS_VALID (timer->start))
+    return TRUE;
+
+  timer->total += gst_util_get_timestamp () - timer->start;
+  timer->start = GST_CLOCK_TIME_NONE;
+  timer->samples += 1;
+
+  return TRUE;
+}
+
+static void
+encode_timer_attach (EncodeTimer *timer, GstElement *encoder,
+    GCallback src_probe)
+{
+  GstPad *pad;
+
+  timer->start = GST_CLOCK_TIME_NONE;
+  timer->total = 0;
+  timer->samples = 0;
+
+  pad = gst_element_get_static_pad (encoder, "sink");
+  gst_pad_add_buffer_probe (pad, G_CALLBACK (encode_timer_sink_probe), timer);
+  gst_object_unref (pad);
+
+  pad = gst_element_get_static_pad (encoder, "src");
+  gst_pad_add_buffer_probe (pad, src_probe, timer);
+  gst_object_unref (pad);
+}
+
+static gboolean
+encode_rate_sink_event_probe (GstPad *pad, GstEvent *event, EncodeRate *rate)
+{
+  if (GST_EVENT_TYPE (event) == GST_EVENT_EOS)
+    rate->eos = TRUE;
+
+  return TRUE;
+}
+
+static gboolean
+encode_rate_src_probe (GstPad *pad, GstBuffer *buffer, EncodeRate *rate)
+{
+  GstClockTime now;
+
+  if (rate->eos)
+    return TRUE;
+
+  now = gst_util_get_timestamp ();
+  if (rate->frames == 0)
+    rate->first = now;
+  rate->last = now;
+  rate->frames += 1;
+
+  return TRUE;
+}
+
+static void
+encode_rate_attach (EncodeRate *rate, GstElement *encoder)
+{
+  GstPad *pad;
+
+  rate->first = rate->last = GST_CLOCK_TIME_NONE;
+  rate->frames = 0;
+  rate->eos = FALSE;
+
+  pad = gst_element_get_static_pad (encoder, "sink");
+  gst_pad_add_event_probe (pad, G_CALLBACK (encode_rate_sink_event_probe),
+      rate);
+  gst_object_unref (pad);
+
+  pad = gst_element_get_static_pad (encoder, "src");
+  gst_pad_add_buffer_probe (pad, G_CALLBACK (encode_rate_src_probe), rate);
+  gst_object_unref (pad);
+}
+
+/* feeds the encoder noise, the worst case for it, as fast as it takes it and
+ * checks that in steady state it outputs a frame in less than the frame
+ * interval minus the headroom. The input runs CALIBRATION_SECONDS past the
+ * encoder delay, and the rate is measured from the first output frame to the
+ * last one before EOS, so neither setting up nor the delay count. */
+static GstRTSPCamCalibration
+calibrate_preset (GstRTSPCamMediaFactory *factory, const gchar *preset,
+    gint width, gint height, gint fps_n, gint fps_d)
+{
+  GstElement *pipeline;
+  GstElement *videosrc, *capsfilter, *queue, *pay, *fakesink;
+  GstElement *encoder;
+  GstCaps *caps;
+  GstBus *bus;
+  GstMessage *message;
+  EncodeRate rate;
+  GstClockTime budget;
+  GstClockTime encode_time;
+  GstRTSPCamCalibration res;
+
+  pay = create_payloader (factory, factory->video_codec,
+      factory->video_codec_options, preset, 0);
+  if (pay == NULL)
+    return GST_RTSP_CAM_CALIBRATION_ERROR;
+
+  encoder = get_encoder (pay);
+  if (encoder == NULL) {
+    GST_ERROR_OBJECT (factory, "couldn't find the %s encoder",
+        factory->video_codec);
+    gst_object_unref (pay);
+
+    return GST_RTSP_CAM_CALIBRATION_ERROR;
+  }
+
+  videosrc = gst_element_factory_make ("videotestsrc", NULL);
+  g_object_set (videosrc, "num-buffers",
+      CALIBRATION_DELAY_FRAMES + MAX (CALIBRATION_SECONDS * fps_n / fps_d, 2),
+      NULL);
+  gst_util_set_object_arg (G_OBJECT (videosrc), "pattern", "snow");
+  capsfilter = gst_element_factory_make ("capsfilter", NULL);
+  caps = gst_caps_new_simple ("video/x-raw-yuv",
+      "format", GST_TYPE_FOURCC, GST_MAKE_FOURCC ('I', '4', '2', '0'),
+      "width", G_TYPE_INT, width,
+      "height", G_TYPE_INT, height,
+      "framerate", GST_TYPE_FRACTION, fps_n, fps_d, NULL);
+  g_object_set (capsfilter, "caps", caps, NULL);
+  gst_caps_unref (caps);
+  /* generating noise mustn't slow the encoder down */
+  queue = gst_element_factory_make ("queue", NULL);
+  fakesink = gst_element_factory_make ("fakesink", NULL);
+  g_object_set (fakesink, "sync", FALSE, NULL);
+
+  pipeline = gst_pipeline_new (NULL);
+  gst_bin_add_many (GST_BIN (pipeline), videosrc, capsfilter, queue, pay,
+      fakesink, NULL);
+  gst_element_link_many (videosrc, capsfilter, queue, pay, fakesink, NULL);
+  encode_rate_attach (&rate, encoder);
+
+  bus = gst_element_get_bus (pipeline);
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+  message = gst_bus_timed_pop_filtered (bus, CALIBRATION_TIMEOUT,
+      GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (bus);
+  gst_object_unref (pipeline);
+
+  budget = gst_util_uint64_scale (GST_SECOND, fps_d, fps_n) *
+      (100 - factory->video_codec_headroom) / 100;
+
+  if (message == NULL) {
+    GST_INFO_OBJECT (factory, "preset %s didn't finish in %" GST_TIME_FORMAT,
+        preset, GST_TIME_ARGS (CALIBRATION_TIMEOUT));
+
+    /* slow enough not to finish, judge it on what it did output */
+    if (rate.frames < 2)
+      return GST_RTSP_CAM_CALIBRATION_OVERLOADED;
+  } else if (GST_MESSAGE_TYPE (message) == GST_MESSAGE_ERROR) {
+    GError *error;
+    gchar *debug;
+
+    gst_message_parse_error (message, &error, &debug);
+    GST_ERROR_OBJECT (factory, "calibrating preset %s failed: %s", preset,
+        error->message);
+    g_error_free (error);
+    g_free (debug);
+    gst_message_unref (message);
+
+    return GST_RTSP_CAM_CALIBRATION_ERROR;
+  } else {
+    gst_message_unref (message);
+  }
+
+  if (rate.frames < 2) {
+    GST_ERROR_OBJECT (factory, "preset %s produced %u frames before EOS",
+        preset, rate.frames);
+
+    return GST_RTSP_CAM_CALIBRATION_ERROR;
+  }
+
+  encode_time = (rate.last - rate.first) / (rate.frames - 1);
+  res = encode_time <= budget ?
+      GST_RTSP_CAM_CALIBRATION_OK : GST_RTSP_CAM_CALIBRATION_OVERLOADED;
+  GST_INFO_OBJECT (factory, "preset %s takes %" GST_TIME_FORMAT " per frame "
+      "over %u frames, budget %" GST_TIME_FORMAT, preset,
+      GST_TIME_ARGS (encode_time), rate.frames, GST_TIME_ARGS (budget));
+
+  return res;
+}
+
+/* picks the best quality preset of the video codec that can encode at the
+ * configured size and frame rate. Returns GST_RTSP_CAM_CALIBRATION_OVERLOADED
+ * if even the fastest can't, in which case the fastest is used, and
+ * GST_RTSP_CAM_CALIBRATION_ERROR if the encoder can't run at all. */
+GstRTSPCamCalibration
+gst_rtsp_cam_media_factory_calibrate (GstRTSPCamMediaFactory *factory)
+{
+  CodecDescriptor *codec;
+  GstRTSPCamCalibration res;
+  gint width, height, fps_n, fps_d;
+  gint i;
+
+  codec = find_codec (factory, factory->video_codec);
+  if (codec == NULL || codec->presets == NULL) {
+    GST_ERROR_OBJECT (factory, "no presets to calibrate for codec %s",
+        factory->video_codec);
+
+    return GST_RTSP_CAM_CALIBRATION_ERROR;
+  }
+
+  if (!gst_rtsp_cam_media_factory_get_video_format (factory,
+          &width, &height, &fps_n, &fps_d))
+    GST_WARNING_OBJECT (factory, "video size or framerate not configured, "
+        "calibrating for %dx%d at %d/%d fps", width, height, fps_n, fps_d);
+
+  for (i = 0; codec->presets[i] != NULL; i++) {
+    res = calibrate_preset (factory, codec->presets[i],
+        width, height, fps_n, fps_d);
+
+    if (res == GST_RTSP_CAM_CALIBRATION_ERROR)
+      return res;
+
+    if (res == GST_RTSP_CAM_CALIBRATION_OK) {
+      GST_INFO_OBJECT (factory, "selected preset %s", codec->presets[i]);
+      g_atomic_int_set (&factory->video_codec_preset, i);
+
+      return res;
+    }
+  }
+
+  GST_WARNING_OBJECT (factory, "no preset sustains %dx%d at %d/%d fps, "
+      "using %s", width, height, fps_n, fps_d, codec->presets[i - 1]);
+  g_atomic_int_set (&factory->video_codec_preset, i - 1);
+
+  return GST_RTSP_CAM_CALIBRATION_OVERLOADED;
+}
+
+static void
+encoder_monitor_free (EncoderMonitor *monitor)
+{
+  g_object_unref (monitor->factory);
+  g_free (monitor);
+}
+
+static gboolean
+unprepare_media (GstRTSPMedia *media)
+{
+  gst_rtsp_media_unprepare (media);
+  g_object_unref (media);
+
+  return FALSE;
+}
+
+/* Makes the factory use the next faster preset. Stepping down from the preset
+ * this media runs with, rather than the current one, keeps medias that are
+ * overloaded at the same time from stepping down more than once.
+ *
+ * Encoders with live presets get the new one right away. The others only read
+ * their speed settings when they're set up, so the media is unprepared to be
+ * built again with the new preset, which drops its clients. The media can't be
+ * unprepared from the streaming thread, that's done from the main loop.
+ *
+ * Returns TRUE if the encoder should still be monitored.
+ */
+static gboolean
+encoder_monitor_step_down (EncoderMonitor *monitor)
+{
+  GstRTSPCamMediaFactory *factory = monitor->factory;
+  gint preset = monitor->preset;
+  const gchar *next = monitor->codec->presets[preset + 1];
+
+  if (next == NULL) {
+    GST_WARNING_OBJECT (factory, "encoder overloaded with the fastest preset");
+
+    return FALSE;
+  }
+
+  g_atomic_int_compare_and_exchange (&factory->video_codec_preset,
+      preset, preset + 1);
+  monitor->preset = preset + 1;
+
+  if (monitor->codec->live_presets) {
+    gchar **option = g_strsplit (next, "=", 2);
+
+    GST_WARNING_OBJECT (factory, "encoder overloaded with %s, switching to %s",
+        monitor->codec->presets[preset], next);
+    gst_util_set_object_arg (G_OBJECT (monitor->encoder), option[0],
+        option[1]);
+    g_strfreev (option);
+
+    return TRUE;
+  }
+
+  if (monitor->media == NULL) {
+    GST_WARNING_OBJECT (factory, "encoder overloaded with %s, new medias "
+        "will use %s", monitor->codec->presets[preset], next);
+
+    return FALSE;
+  }
+
+  GST_WARNING_OBJECT (factory, "encoder overloaded with %s, restarting the "
+      "media with %s", monitor->codec->presets[preset], next);
+  g_idle_add ((GSourceFunc) unprepare_media, g_object_ref (monitor->media));
+
+  return FALSE;
+}
+
+static gboolean
+encoder_monitor_src_probe (GstPad *pad, GstBuffer *buffer,
+    EncoderMonitor *monitor)
+{
+  EncodeTimer *timer = &monitor->timer;
+
+  if (monitor->stopped)
+    return TRUE;
+
+  encode_timer_src_probe (pad, buffer, timer);
+  if (timer->samples < monitor->window)
+    return TRUE;
+
+  if (timer->total / timer->samples > monitor->budget)
+    monitor->overloaded += 1;
+  else
+    monitor->overloaded = 0;
+
+  if (monitor->overloaded == OVERLOAD_WINDOWS) {
+    monitor->stopped = !encoder_monitor_step_down (monitor);
+    monitor->overloaded = 0;
+  }
+
+  timer->total = 0;
+  timer->samples = 0;
+
+  return TRUE;
+}
+
+static void
+monitor_encoder (GstRTSPCamMediaFactory *factory, GstElement *bin,
+    GstElement *pay, gint fps_n, gint fps_d)
+{
+  EncoderMonitor *monitor;
+  CodecDescriptor *codec;
+  GstElement *encoder;
+  gint preset;
+
+  if (!factory->video_codec_autotune)
+    return;
+
+  codec = find_codec (factory, factory->video_codec);
+  preset = g_atomic_int_get (&factory->video_codec_preset);
+  if (codec == NULL || codec->presets == NULL || preset < 0)
+    return;
+
+  encoder = get_encoder (pay);
+  if (encoder == NULL)
+    return;
+
+  monitor = g_new0 (EncoderMonitor, 1);
+  monitor->factory = g_object_ref (factory);
+  monitor->encoder = encoder;
+  monitor->codec = codec;
+  monitor->preset = preset;
+  monitor->budget = gst_util_uint64_scale (GST_SECOND, fps_d, fps_n) *
+      (100 - factory->video_codec_headroom) / 100;
+  monitor->window = MAX (fps_n / fps_d, 1);
+  g_object_set_data_full (G_OBJECT (bin), "encoder-monitor", monitor,
+      (GDestroyNotify) encoder_monitor_free);
+
+  encode_timer_attach (&monitor->timer, encoder,
+      G_CALLBACK (encoder_monitor_src_probe));
+}
+
+static void
+export_handoff (GstElement *fakesink, GstBuffer *buffer,
+    GstPad *pad, GstRTSPCamShmWriter *writer)
+{
+  gst_rtsp_cam_shm_writer_write (writer, buffer);
+}
+
+/* there's one writer per factory, shared by all the medias it creates, so
+ * that a media going away never closes the segment another one writes to */
+static GstRTSPCamShmWriter *
+get_video_export_writer (GstRTSPCamMediaFactory *factory)
+{
+  GstRTSPCamShmWriter *writer;
+
+  g_mutex_lock (factory->video_export_lock);
+  if (factory->video_export_writer == NULL)
+    factory->video_export_writer =
+        gst_rtsp_cam_shm_writer_new (factory->video_export,
+            factory->video_export_slots);
+  writer = factory->video_export_writer;
+  g_mutex_unlock (factory->video_export_lock);
+
+  return writer;
+}
+
+/* links the raw video in src to the payloader, teeing it off to shared memory
+ * when video-export is set. The export branch is behind a leaky queue so a
+ * slow copy never holds back the camera.
+ */
+static void
+link_video_export (GstRTSPCamMediaFactory *factory, GstElement *bin,
+    GstElement *src, GstElement *pay)
+{
+  GstRTSPCamShmWriter *writer;
+  GstElement *tee, *queue, *fakesink;
+
+  if (factory->video_export == NULL || *factory->video_export == '\0') {
+    gst_element_link (src, pay);
+
+    return;
+  }
+
+  writer = get_video_export_writer (factory);
+  if (writer == NULL) {
+    gst_element_link (src, pay);
+
+    return;
+  }
+
+  tee = gst_element_factory_make ("tee", NULL);
+  queue = gst_element_factory_make ("queue", NULL);
+  g_object_set (queue, "leaky", 2, "max-size-buffers", 1,
+      "max-size-bytes", 0, "max-size-time", (guint64) 0, NULL);
+  fakesink = gst_element_factory_make ("fakesink", NULL);
+  g_object_set (fakesink, "sync", FALSE, "async", FALSE,
+      "signal-handoffs", TRUE, NULL);
+  g_signal_connect (fakesink, "handoff", G_CALLBACK (export_handoff), writer);
+
+  gst_bin_add_many (GST_BIN (bin), tee, queue, fakesink, NULL);
+  gst_element_link_many (src, tee, pay, NULL);
+  gst_element_link_many (tee, queue, fakesink, NULL);
+
+  GST_INFO_OBJECT (factory, "exporting raw video to %s", factory->video_export);
+}
+
+static void
+mosaic_free (Mosaic *mosaic)
+{
+  guint i;
+
+  if (mosaic->retry_source)
+    g_source_remove (mosaic->retry_source);
+
+  for (i = 0; i < mosaic->n_tiles; i++) {
+    MosaicTile *tile = &mosaic->tiles[i];
+
+    if (tile->bin)
+      gst_object_unref (tile->bin);
+    if (tile->buffer)
+      gst_buffer_unref (tile->buffer);
+    g_mutex_free (tile->lock);
+  }
+
+  g_free (mosaic->tiles);
+  g_free (mosaic);
+}
+
+static void
+mosaic_tile_handoff (GstElement *fakesink, GstBuffer *buffer,
+    GstPad *pad, MosaicTile *tile)
+{
+  GstBuffer *old;
+
+  g_mutex_lock (tile->lock);
+  old = tile->buffer;
+  tile->buffer = gst_buffer_ref (buffer);
+  g_mutex_unlock (tile->lock);
+
+  if (old)
+    gst_buffer_unref (old);
+}
+
+static void
+mosaic_blit_tile (Mosaic *mosaic, MosaicTile *tile,
+    GstBuffer *tile_buffer, guint8 *data)
+{
+  GstVideoFormat format = GST_VIDEO_FORMAT_I420;
+  gint comp;
+
+  if (GST_BUFFER_SIZE (tile_buffer) <
+      gst_video_format_get_size (format, tile->width, tile->height))
+    return;
+
+  for (comp = 0; comp < 3; comp++) {
+    guint8 *src, *dest;
+    gint src_stride, dest_stride;
+    gint width, height;
+    gint row;
+
+    src_stride = gst_video_format_get_row_stride (format, comp, tile->width);
+    dest_stride = gst_video_format_get_row_stride (format, comp, mosaic->width);
+    width = gst_video_format_get_component_width (format, comp, tile->width);
+    height = gst_video_format_get_component_height (format, comp, tile->height);
+
+    src = GST_BUFFER_DATA (tile_buffer) +
+        gst_video_format_get_component_offset (format, comp,
+            tile->width, tile->height);
+    dest = data +
+        gst_video_format_get_component_offset (format, comp,
+            mosaic->width, mosaic->height) +
+        gst_video_format_get_component_height (format, comp, tile->y) * dest_stride +
+        gst_video_format_get_component_width (format, comp, tile->x);
+
+    for (row = 0; row < height; row++) {
+      memcpy (dest, src, width);
+      src += src_stride;
+      dest += dest_stride;
+    }
+  }
+}
+
+/* runs for every frame produced by the live background source, so the mosaic
+ * is paced by its own clock and a stalled camera just repeats its last frame
+ */
+/* restarts the cameras that failed, so that a camera that was unplugged or
+ * whose server was restarted shows up again */
+static gboolean
+mosaic_retry_tiles (Mosaic *mosaic)
+{
+  guint i;
+
+  for (i = 0; i < mosaic->n_tiles; i++) {
+    MosaicTile *tile = &mosaic->tiles[i];
+    MosaicTileBin *tile_bin = (MosaicTileBin *) tile->bin;
+
+    if (tile_bin == NULL || !g_atomic_int_get (&tile_bin->failed))
+      continue;
+
+    GST_INFO_OBJECT (tile_bin, "retrying failed camera");
+    gst_element_set_state (tile->bin, GST_STATE_NULL);
+    g_atomic_int_set (&tile_bin->failed, FALSE);
+    gst_element_sync_state_with_parent (tile->bin);
+  }
+
+  return TRUE;
+}
+
+static gboolean
+mosaic_composite (GstPad *pad, GstBuffer *buffer, Mosaic *mosaic)
+{
+  guint i;
+
+  if (GST_BUFFER_SIZE (buffer) < gst_video_format_get_size (GST_VIDEO_FORMAT_I420,
+          mosaic->width, mosaic->height))
+    return TRUE;
+
+  for (i = 0; i < mosaic->n_tiles; i++) {
+    MosaicTile *tile = &mosaic->tiles[i];
+    GstBuffer *tile_buffer;
+
+    g_mutex_lock (tile->lock);
+    tile_buffer = tile->buffer ? gst_buffer_ref (tile->buffer) : NULL;
+    g_mutex_unlock (tile->lock);
+
+    if (tile_buffer == NULL)
+      continue;
+
+    mosaic_blit_tile (mosaic, tile, tile_buffer, GST_BUFFER_DATA (buffer));
+    gst_buffer_unref (tile_buffer);
+  }
+
+  return TRUE;
+}
+
+static GstStateChangeReturn
+mosaic_tile_bin_change_state (GstElement *element, GstStateChange transition)
+{
+  MosaicTileBin *tile_bin = (MosaicTileBin *) element;
+  GstStateChangeReturn ret;
+
+  /* a failed camera stays down until mosaic_retry_tiles () resets it, but
+   * still gets shut down */
+  if (GST_STATE_TRANSITION_NEXT (transition) >
+          GST_STATE_TRANSITION_CURRENT (transition) &&
+      g_atomic_int_get (&tile_bin->failed))
+    return GST_STATE_CHANGE_SUCCESS;
+
+  ret = GST_ELEMENT_CLASS (mosaic_tile_bin_parent_class)->change_state (element,
+      transition);
+  if (ret == GST_STATE_CHANGE_FAILURE) {
+    GST_WARNING_OBJECT (element, "camera failed to start, leaving its tile black");
+    g_atomic_int_set (&tile_bin->failed, TRUE);
+    ret = GST_STATE_CHANGE_SUCCESS;
+  }
+
+  return ret;
+}
+
+static void
+mosaic_tile_bin_handle_message (GstBin *bin, GstMessage *message)
+{
+  MosaicTileBin *tile_bin = (MosaicTileBin *) bin;
+
+  switch (GST_MESSAGE_TYPE (message)) {
+    case GST_MESSAGE_ERROR:
+    {
+      GError *error;
+      gchar *debug;
+
+      gst_message_parse_error (message, &error, &debug);
+      GST_WARNING_OBJECT (bin, "camera failed, freezing its tile: %s",
+          error->message);
+      g_error_free (error);
+      g_free (debug);
+
+      g_atomic_int_set (&tile_bin->failed, TRUE);
+      gst_message_unref (message);
+      break;
+    }
+    case GST_MESSAGE_EOS:
+      gst_message_unref (message);
+      break;
+    default:
+      GST_BIN_CLASS (mosaic_tile_bin_parent_class)->handle_message (bin, message);
+  }
+}
+
+static void
+mosaic_tile_bin_class_init (MosaicTileBinClass *klass)
+{
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+  GstBinClass *bin_class = GST_BIN_CLASS (klass);
+
+  element_class->change_state = mosaic_tile_bin_change_state;
+  bin_class->handle_message = mosaic_tile_bin_handle_message;
+}
+
+static void
+mosaic_tile_bin_init (MosaicTileBin *tile_bin)
+{
+}
+
+static void
+mosaic_tile_pad_added (GstElement *decodebin, GstPad *pad, GstElement *queue)
+{
+  GstPad *sinkpad;
+  GstCaps *caps;
+  gboolean video;
+
+  caps = gst_pad_get_caps (pad);
+  video = g_str_has_prefix (gst_structure_get_name (
+          gst_caps_get_structure (caps, 0)), "video/");
+  gst_caps_unref (caps);
+  if (!video)
+    return;
+
+  sinkpad = gst_element_get_static_pad (queue, "sink");
+  if (!gst_pad_is_linked (sinkpad))
+    gst_pad_link (pad, sinkpad);
+  gst_object_unref (sinkpad);
+}
+
+/* A tile is either a URI, typically the mount of another gst-rtsp-cam, or a
+ * video device. A device is opened directly, so it can't be used by another
+ * gst-rtsp-cam at the same time: its tile would stay black. */
+static gboolean
+create_mosaic_tile (GstRTSPCamMediaFactory *factory, GstElement *bin,
+    const gchar *device, MosaicTile *tile)
+{
+  GstElement *tile_bin;
+  GstElement *videosrc;
+  GstElement *queue, *ffmpegcolorspace, *videoscale;
+  GstElement *capsfilter, *fakesink;
+  GstCaps *caps;
+  gboolean uri;
+
+  uri = gst_uri_is_valid (device);
+  if (uri) {
+    videosrc = gst_element_factory_make ("uridecodebin", NULL);
+    if (videosrc)
+      g_object_set (videosrc, "uri", device, NULL);
+  } else {
+    videosrc = gst_element_factory_make ("v4l2src", NULL);
+    if (videosrc)
+      g_object_set (videosrc, "device", device, NULL);
+  }
+
+  if (videosrc == NULL) {
+    GST_WARNING_OBJECT (factory, "couldn't create video source for %s", device);
+
+    return FALSE;
+  }
+
+  /* never let a slow tile hold back its camera */
+  queue = gst_element_factory_make ("queue", NULL);
+  g_object_set (queue, "leaky", 2, "max-size-buffers", 1,
+      "max-size-bytes", 0, "max-size-time", (guint64) 0, NULL);
+  ffmpegcolorspace = gst_element_factory_make ("ffmpegcolorspace", NULL);
+  videoscale = gst_element_factory_make ("videoscale", NULL);
+  capsfilter = gst_element_factory_make ("capsfilter", NULL);
+  fakesink = gst_element_factory_make ("fakesink", NULL);
+  g_object_set (fakesink, "sync", FALSE, "async", FALSE,
+      "signal-handoffs", TRUE, NULL);
+
+  caps = gst_caps_new_simple ("video/x-raw-yuv",
+      "format", GST_TYPE_FOURCC, GST_MAKE_FOURCC ('I', '4', '2', '0'),
+      "width", G_TYPE_INT, tile->width,
+      "height", G_TYPE_INT, tile->height, NULL);
+  g_object_set (capsfilter, "caps", caps, NULL);
+  gst_caps_unref (caps);
+
+  g_signal_connect (fakesink, "handoff",
+      G_CALLBACK (mosaic_tile_handoff), tile);
+
+  tile_bin = g_object_new (mosaic_tile_bin_get_type (), NULL);
+  gst_bin_add_many (GST_BIN (tile_bin), videosrc, queue, ffmpegcolorspace,
+      videoscale, capsfilter, fakesink, NULL);
+  gst_element_link_many (queue, ffmpegcolorspace, videoscale,
+      capsfilter, fakesink, NULL);
+  if (uri)
+    g_signal_connect (videosrc, "pad-added",
+        G_CALLBACK (mosaic_tile_pad_added), queue);
+  else
+    gst_element_link (videosrc, queue);
+  gst_bin_add (GST_BIN (bin), tile_bin);
+  tile->bin = gst_object_ref (tile_bin);
+
+  return TRUE;
+}
+
+static GstElement *
+create_mosaic_payloader (GstRTSPCamMediaFactory *factory,
+    GstElement *bin, gint payloader_number)
+{
+  GstElement *pay;
+  GstElement *videosrc, *capsfilter;
+  GstCaps *video_caps;
+  GstPad *pad;
+  Mosaic *mosaic;
+  gchar **devices;
+  gint width, height;
+  gint columns, rows;
+  gint tile_width, tile_height;
+  gint fps_n, fps_d;
+  guint n_tiles;
+  guint i;
+
+  if (factory->video_device) {
+    GST_ERROR_OBJECT (factory, "a video device can't be used with a mosaic, "
+        "add it to the mosaic devices instead");
+
+    return NULL;
+  }
+
+  devices = g_strsplit (factory->mosaic_devices, ",", -1);
+  if (devices[0] == NULL) {
+    GST_ERROR_OBJECT (factory, "no mosaic devices");
+    g_strfreev (devices);
+
+    return NULL;
+  }
+
+  gst_rtsp_cam_media_factory_get_video_format (factory,
+      &width, &height, &fps_n, &fps_d);
+  n_tiles = g_strv_length (devices);
+
+  columns = factory->mosaic_columns;
+  if (columns == 0)
+    columns = (gint) ceil (sqrt (n_tiles));
+  columns = MIN (columns, (gint) n_tiles);
+  rows = (n_tiles + columns - 1) / columns;
+
+  tile_width = GST_ROUND_DOWN_2 (width / columns);
+  tile_height = GST_ROUND_DOWN_2 (height / rows);
+  if (tile_width < 2 || tile_height < 2) {
+    GST_ERROR_OBJECT (factory, "%dx%d is too small for a %dx%d mosaic",
+        width, height, columns, rows);
+    g_strfreev (devices);
+
+    return NULL;
+  }
+
+  pay = create_payloader (factory, factory->video_codec,
+      factory->video_codec_options, get_video_codec_preset (factory),
+      payloader_number);
+  if (pay == NULL) {
+    g_strfreev (devices);
+
+    return NULL;
+  }
+
+  mosaic = g_new0 (Mosaic, 1);
+  mosaic->width = width;
+  mosaic->height = height;
+  mosaic->n_tiles = n_tiles;
+  mosaic->tiles = g_new0 (MosaicTile, mosaic->n_tiles);
+  g_object_set_data_full (G_OBJECT (bin), "mosaic", mosaic,
+      (GDestroyNotify) mosaic_free);
+
+  for (i = 0; i < mosaic->n_tiles; i++) {
+    MosaicTile *tile = &mosaic->tiles[i];
+
+    tile->lock = g_mutex_new ();
+    tile->width = tile_width;
+    tile->height = tile_height;
+    tile->x = (i % columns) * tile->width;
+    tile->y = (i / columns) * tile->height;
+
+    if (!create_mosaic_tile (factory, bin, g_strstrip (devices[i]), tile))
+      continue;
+
+    GST_INFO_OBJECT (factory, "mosaic tile %s at %dx%d+%d+%d", devices[i],
+        tile->width, tile->height, tile->x, tile->y);
+  }
+  g_strfreev (devices);
+
+  mosaic->retry_source = g_timeout_add_seconds (MOSAIC_RETRY_SECONDS,
+      (GSourceFunc) mosaic_retry_tiles, mosaic);
+
+  /* the background paces the mosaic, tiles are painted over it */
+  videosrc = gst_element_factory_make ("videotestsrc", NULL);
+  g_object_set (videosrc, "is-live", TRUE, "pattern", 2, NULL);
+  capsfilter = gst_element_factory_make ("capsfilter", NULL);
+
+  video_caps = gst_caps_new_simple ("video/x-raw-yuv",
+      "format", GST_TYPE_FOURCC, GST_MAKE_FOURCC ('I', '4', '2', '0'),
+      "width", G_TYPE_INT, mosaic->width,
+      "height", G_TYPE_INT, mosaic->height,
+      "framerate", GST_TYPE_FRACTION, fps_n, fps_d, NULL);
+  g_object_set (capsfilter, "caps", video_caps, NULL);
+  gst_caps_unref (video_caps);
+
+  pad = gst_element_get_static_pad (videosrc, "src");
+  gst_pad_add_buffer_probe (pad, G_CALLBACK (mosaic_composite), mosaic);
+  gst_object_unref (pad);
+
+  gst_bin_add_many (GST_BIN (bin), videosrc, capsfilter, pay, NULL);
+  gst_element_link (videosrc, capsfilter);
+  link_video_export (factory, bin, capsfilter, pay);
+  monitor_encoder (factory, bin, pay, fps_n, fps_d);
+
+  return pay;
+}
+
 static GstElement *
 create_video_payloader (GstRTSPCamMediaFactory *factory,
     GstElement *bin, gint payloader_number)
@@ -353,10 +1511,15 @@ create_video_payloader (GstRTSPCamMediaFactory *factory,
       "video/x-raw-rgb", "video/x-raw-gray", NULL};
   GstCaps *video_caps;
   gchar *capss;
+  gint width, height, fps_n, fps_d;
   int i;
 
+  if (factory->mosaic_devices && *factory->mosaic_devices)
+    return create_mosaic_payloader (factory, bin, payloader_number);
+
   pay = create_payloader (factory, factory->video_codec,
-      factory->video_codec_options, payloader_number);
+      factory->video_codec_options, get_video_codec_preset (factory),
+      payloader_number);
   if (pay == NULL)
     return NULL;
 
@@ -374,7 +1537,8 @@ create_video_payloader (GstRTSPCamMediaFactory *factory,
   gst_bin_add_many (GST_BIN (bin), videosrc, queue, ffmpegcolorspace, videoscale,
       videorate, capsfilter, pay, NULL);
   gst_element_link_many (videosrc, queue, videorate, ffmpegcolorspace, videoscale,
-      capsfilter, pay, NULL);
+      capsfilter, NULL);
+  link_video_export (factory, bin, capsfilter, pay);
 
   video_caps = gst_caps_new_empty ();
   for (i = 0; image_formats[i] != NULL; i++) {
@@ -399,6 +1563,10 @@ create_video_payloader (GstRTSPCamMediaFactory *factory,
 
   g_object_set (capsfilter, "caps", video_caps, NULL);
 
+  gst_rtsp_cam_media_factory_get_video_format (factory,
+      &width, &height, &fps_n, &fps_d);
+  monitor_encoder (factory, bin, pay, fps_n, fps_d);
+
   return pay;
 }
 
@@ -412,7 +1580,7 @@ create_audio_payloader (GstRTSPCamMediaFactory *factory,
   GstElement *audiorate;
 
   pay = create_payloader (factory, factory->audio_codec,
-      factory->audio_codec_options, payloader_number);
+      factory->audio_codec_options, NULL, payloader_number);
   if (pay == NULL)
     return NULL;
 
@@ -478,3 +1646,104 @@ gst_rtsp_cam_media_factory_gen_key (GstRTSPMediaFactory *factory, const GstRTSPU
   return g_strdup (url->abspath);
 }
 
+static void
+gst_rtsp_cam_media_factory_configure (GstRTSPMediaFactory *factory,
+    GstRTSPMedia *media)
+{
+  EncoderMonitor *monitor;
+
+  GST_RTSP_MEDIA_FACTORY_CLASS (gst_rtsp_cam_media_factory_parent_class)->configure (factory,
+      media);
+
+  /* lets the monitor restart the media to apply a faster preset */
+  monitor = g_object_get_data (G_OBJECT (media->element), "encoder-monitor");
+  if (monitor)
+    monitor->media = media;
+}
+
+
+static gboolean keep_alive_restart (GstRTSPCamMediaFactory *factory);
+
+static void
+keep_alive_unprepared (GstRTSPMedia *media, GstRTSPCamMediaFactory *factory)
+{
+  GST_WARNING_OBJECT (factory, "kept alive media stopped, restarting it in "
+      "%d seconds", KEEP_ALIVE_RETRY_SECONDS);
+
+  g_timeout_add_seconds (KEEP_ALIVE_RETRY_SECONDS,
+      (GSourceFunc) keep_alive_restart, factory);
+}
+
+static gboolean
+keep_alive_start (GstRTSPCamMediaFactory *factory)
+{
+  GstRTSPMedia *media;
+  GArray *transports;
+
+  media = gst_rtsp_media_factory_construct (GST_RTSP_MEDIA_FACTORY (factory),
+      factory->keep_alive_url);
+  if (media == NULL) {
+    GST_ERROR_OBJECT (factory, "couldn't create the media to keep alive");
+
+    return FALSE;
+  }
+
+  if (!gst_rtsp_media_prepare (media)) {
+    GST_ERROR_OBJECT (factory, "couldn't prepare the media to keep alive");
+    g_object_unref (media);
+
+    return FALSE;
+  }
+
+  g_signal_connect (media, "unprepared",
+      G_CALLBACK (keep_alive_unprepared), factory);
+
+  /* we count as an active client with no transports, so the media keeps
+   * playing when the last real client goes away */
+  transports = g_array_new (FALSE, TRUE, sizeof (GstRTSPMediaTrans *));
+  gst_rtsp_media_set_state (media, GST_STATE_PLAYING, transports);
+  g_array_free (transports, TRUE);
+
+  factory->keep_alive_media = media;
+
+  return TRUE;
+}
+
+static gboolean
+keep_alive_restart (GstRTSPCamMediaFactory *factory)
+{
+  if (factory->keep_alive_media) {
+    g_signal_handlers_disconnect_by_func (factory->keep_alive_media,
+        keep_alive_unprepared, factory);
+    g_object_unref (factory->keep_alive_media);
+    factory->keep_alive_media = NULL;
+  }
+
+  if (!keep_alive_start (factory))
+    g_timeout_add_seconds (KEEP_ALIVE_RETRY_SECONDS,
+        (GSourceFunc) keep_alive_restart, factory);
+
+  return FALSE;
+}
+
+/* Keeps the shared media for url prepared and playing even when no client is
+ * connected, so that the capture and the raw video export never stop. The
+ * media is held in process and restarted whenever it's unprepared. Must be
+ * called from the default main context. */
+gboolean
+gst_rtsp_cam_media_factory_keep_alive (GstRTSPCamMediaFactory *factory,
+    const GstRTSPUrl *url)
+{
+  g_return_val_if_fail (GST_IS_RTSP_CAM_MEDIA_FACTORY (factory), FALSE);
+  g_return_val_if_fail (url != NULL, FALSE);
+  g_return_val_if_fail (factory->keep_alive_url == NULL, FALSE);
+
+  factory->keep_alive_url = gst_rtsp_url_copy ((GstRTSPUrl *) url);
+  if (keep_alive_start (factory))
+    return TRUE;
+
+  g_timeout_add_seconds (KEEP_ALIVE_RETRY_SECONDS,
+      (GSourceFunc) keep_alive_restart, factory);
+
+  return FALSE;
+}
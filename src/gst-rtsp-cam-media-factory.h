@@ -19,6 +19,7 @@
 
 #include <gst/gst.h>
 #include <gst/rtsp-server/rtsp-media-factory.h>
+#include "gst-rtsp-cam-shm.h"
 
 #ifndef __GST_RTSP_CAM_MEDIA_FACTORY_H__
 #define __GST_RTSP_CAM_MEDIA_FACTORY_H__
@@ -38,6 +39,12 @@ G_BEGIN_DECLS
 typedef struct _GstRTSPCamMediaFactory GstRTSPCamMediaFactory;
 typedef struct _GstRTSPCamMediaFactoryClass GstRTSPCamMediaFactoryClass;
 
+typedef enum {
+  GST_RTSP_CAM_CALIBRATION_OK,
+  GST_RTSP_CAM_CALIBRATION_OVERLOADED,
+  GST_RTSP_CAM_CALIBRATION_ERROR
+} GstRTSPCamCalibration;
+
 struct _GstRTSPCamMediaFactory {
   GstRTSPMediaFactory factory;
 
@@ -51,10 +58,22 @@ struct _GstRTSPCamMediaFactory {
   gint fps_d;
   gchar *video_codec;
   gchar *video_codec_options;
+  gboolean video_codec_autotune;
+  gint video_codec_headroom;
+  gint video_codec_preset;
+  gchar *video_export;
+  gint video_export_slots;
+  GMutex *video_export_lock;
+  GstRTSPCamShmWriter *video_export_writer;
+  GstRTSPUrl *keep_alive_url;
+  GstRTSPMedia *keep_alive_media;
 
   gchar *audio_device;
   gchar *audio_codec;
   gchar *audio_codec_options;
+
+  gchar *mosaic_devices;
+  gint mosaic_columns;
 };
 
 struct _GstRTSPCamMediaFactoryClass {
@@ -64,6 +83,11 @@ struct _GstRTSPCamMediaFactoryClass {
 GType gst_rtsp_cam_media_factory_get_type (void);
 
 GstRTSPCamMediaFactory * gst_rtsp_cam_media_factory_new ();
+GstRTSPCamCalibration gst_rtsp_cam_media_factory_calibrate (GstRTSPCamMediaFactory *factory);
+gboolean gst_rtsp_cam_media_factory_get_video_format (GstRTSPCamMediaFactory *factory,
+    gint *width, gint *height, gint *fps_n, gint *fps_d);
+gboolean gst_rtsp_cam_media_factory_keep_alive (GstRTSPCamMediaFactory *factory,
+    const GstRTSPUrl *url);
 
 G_END_DECLS
 
@@ -0,0 +1,100 @@
+/*
+ * This program is free software. It comes without any warranty, to
+ * the extent permitted by applicable law. You can redistribute it
+ * and/or modify it under the terms of the Do What The Fuck You Want
+ * To Public License, Version 2, as published by Sam Hocevar. See
+ * http://sam.zoy.org/wtfpl/COPYING for more details.
+ *
+ * Author: Alessandro Decina <alessandro.d@gmail.com>
+ */
+
+/* Example consumer of the raw video exported by gst-rtsp-cam --video-export.
+ * It maps the shared memory read-only and prints the newest frame every time
+ * one shows up, along with how many were skipped since the previous one. When
+ * the server closes the segment it waits for a new one to show up.
+ */
+
+#include <gst/gst.h>
+
+#include "gst-rtsp-cam-shm.h"
+
+static int poll_interval = 5;
+
+static const GOptionEntry option_entries[] = {
+  {"poll-interval", 0, 0, G_OPTION_ARG_INT, &poll_interval,
+      "Milliseconds to wait when no new frame is available", NULL},
+  {NULL}
+};
+
+int
+main (int argc, char **argv)
+{
+  GstRTSPCamShmReader *reader = NULL;
+  GstRTSPCamShmFrame frame;
+  GOptionContext *ctx;
+  gboolean res;
+  GError *error = NULL;
+
+  ctx = g_option_context_new ("shared-memory-name");
+  g_option_context_add_main_entries (ctx, option_entries, NULL);
+  res = g_option_context_parse (ctx, &argc, &argv, &error);
+  g_option_context_free (ctx);
+
+  if (!res) {
+    g_printerr ("command line error: %s\n", error->message);
+    g_error_free (error);
+
+    return 1;
+  }
+
+  if (argc != 2) {
+    g_printerr ("missing shared memory name argument\n");
+
+    return 1;
+  }
+
+  while (TRUE) {
+    GstRTSPCamShmReturn ret;
+    guint32 checksum = 0;
+    gsize i;
+
+    if (reader == NULL) {
+      reader = gst_rtsp_cam_shm_reader_new (argv[1]);
+      if (reader == NULL) {
+        g_usleep (poll_interval * 1000);
+        continue;
+      }
+      g_print ("opened shared memory %s\n", argv[1]);
+    }
+
+    ret = gst_rtsp_cam_shm_reader_next (reader, &frame);
+    if (ret == GST_RTSP_CAM_SHM_CLOSED) {
+      g_print ("shared memory %s closed\n", argv[1]);
+      gst_rtsp_cam_shm_reader_free (reader);
+      reader = NULL;
+      continue;
+    }
+
+    if (ret == GST_RTSP_CAM_SHM_NO_FRAME) {
+      g_usleep (poll_interval * 1000);
+      continue;
+    }
+
+    /* frame.data is only guaranteed to be intact if the frame is still valid
+     * after we're done with it */
+    for (i = 0; i < frame.size; i++)
+      checksum += frame.data[i];
+
+    if (!gst_rtsp_cam_shm_reader_frame_valid (reader, &frame)) {
+      g_print ("frame %u overwritten while reading it\n", frame.number);
+      continue;
+    }
+
+    g_print ("frame %u %" GST_TIME_FORMAT " %dx%d %" G_GSIZE_FORMAT
+        " bytes checksum %08x skipped %u %s\n", frame.number,
+        GST_TIME_ARGS (frame.timestamp), frame.width, frame.height,
+        frame.size, checksum, frame.skipped, frame.caps);
+  }
+
+  return 0;
+}
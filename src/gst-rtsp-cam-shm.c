@@ -0,0 +1,425 @@
+/* GStreamer
+ * Copyright (C) 2010 Alessandro Decina <alessandro.d@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "gst-rtsp-cam-shm.h"
+
+#define SLOT_ALIGN 64
+/* how long to wait before creating the segment again after failing to */
+#define MIN_RETRY_DELAY (100 * GST_MSECOND)
+#define MAX_RETRY_DELAY (10 * GST_SECOND)
+
+GST_DEBUG_CATEGORY_STATIC (rtsp_cam_shm_debug);
+#define GST_CAT_DEFAULT rtsp_cam_shm_debug
+
+struct _GstRTSPCamShmWriter {
+  GMutex *lock;
+  gchar *name;
+  guint n_slots;
+
+  int fd;
+  guint8 *map;
+  gsize map_size;
+  GstRTSPCamShmHeader *header;
+  GstClockTime retry_at;
+  GstClockTime retry_delay;
+
+  GstCaps *caps;
+  gchar caps_string[GST_RTSP_CAM_SHM_CAPS_LEN];
+  gint width;
+  gint height;
+};
+
+struct _GstRTSPCamShmReader {
+  int fd;
+  guint8 *map;
+  gsize map_size;
+  GstRTSPCamShmHeader *header;
+
+  gboolean have_last;
+  guint32 last;
+};
+
+/* the counters are shared as plain 32 bit words, glib only has atomic
+ * accessors for gint */
+#define COUNTER_GET(counter) ((guint32) g_atomic_int_get ((gint *) &(counter)))
+#define COUNTER_SET(counter, value) \
+    g_atomic_int_set ((gint *) &(counter), (gint) (guint32) (value))
+
+static GstRTSPCamShmSlot *
+get_slot (const GstRTSPCamShmHeader *header, guint32 number)
+{
+  /* n_slots is a power of two, so this doesn't jump when number wraps */
+  return (GstRTSPCamShmSlot *) ((guint8 *) header +
+      GST_ROUND_UP_N (sizeof (GstRTSPCamShmHeader), SLOT_ALIGN) +
+      (gsize) (number & (header->n_slots - 1)) * header->slot_stride);
+}
+
+static gsize
+get_map_size (guint n_slots, gsize slot_stride)
+{
+  return GST_ROUND_UP_N (sizeof (GstRTSPCamShmHeader), SLOT_ALIGN) +
+      n_slots * slot_stride;
+}
+
+GstRTSPCamShmWriter *
+gst_rtsp_cam_shm_writer_new (const gchar *name, guint n_slots)
+{
+  GstRTSPCamShmWriter *writer;
+
+  g_return_val_if_fail (name != NULL, NULL);
+  g_return_val_if_fail (n_slots >= 2, NULL);
+
+  GST_DEBUG_CATEGORY_INIT (rtsp_cam_shm_debug,
+      "rtspcamshm", 0, "RTSP Cam shared memory export");
+
+  writer = g_new0 (GstRTSPCamShmWriter, 1);
+  writer->lock = g_mutex_new ();
+  writer->name = g_strdup (name);
+  writer->n_slots = 1;
+  while (writer->n_slots < n_slots)
+    writer->n_slots <<= 1;
+  writer->fd = -1;
+
+  return writer;
+}
+
+/* the segment is sized on the first frame, when we know how big frames are.
+ * A stale segment is unlinked rather than truncated, since readers that still
+ * have it mapped would get SIGBUS. */
+static gboolean
+writer_open (GstRTSPCamShmWriter *writer, gsize slot_size)
+{
+  GstRTSPCamShmHeader *header;
+  gsize slot_stride;
+
+  slot_stride = GST_ROUND_UP_N (sizeof (GstRTSPCamShmSlot) + slot_size,
+      SLOT_ALIGN);
+  writer->map_size = get_map_size (writer->n_slots, slot_stride);
+
+  shm_unlink (writer->name);
+  writer->fd = shm_open (writer->name, O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (writer->fd == -1) {
+    GST_ERROR ("couldn't create shared memory %s: %s", writer->name,
+        g_strerror (errno));
+
+    return FALSE;
+  }
+
+  if (ftruncate (writer->fd, writer->map_size) == -1) {
+    GST_ERROR ("couldn't resize shared memory %s: %s", writer->name,
+        g_strerror (errno));
+    goto error;
+  }
+
+  writer->map = mmap (NULL, writer->map_size, PROT_READ | PROT_WRITE,
+      MAP_SHARED, writer->fd, 0);
+  if (writer->map == MAP_FAILED) {
+    GST_ERROR ("couldn't map shared memory %s: %s", writer->name,
+        g_strerror (errno));
+    writer->map = NULL;
+    goto error;
+  }
+
+  header = (GstRTSPCamShmHeader *) writer->map;
+  header->version = GST_RTSP_CAM_SHM_VERSION;
+  header->n_slots = writer->n_slots;
+  header->slot_size = slot_size;
+  header->slot_stride = slot_stride;
+  header->sequence = 0;
+  header->closed = 0;
+  /* readers only attach once the magic is there */
+  g_atomic_int_set ((gint *) &header->magic, GST_RTSP_CAM_SHM_MAGIC);
+  writer->header = header;
+
+  GST_INFO ("exporting %u slots of %" G_GSIZE_FORMAT " bytes in %s",
+      writer->n_slots, slot_size, writer->name);
+
+  return TRUE;
+
+error:
+  close (writer->fd);
+  writer->fd = -1;
+  shm_unlink (writer->name);
+
+  return FALSE;
+}
+
+/* whether the name still points to our segment, and not to one created by
+ * another writer since */
+static gboolean
+writer_owns_name (GstRTSPCamShmWriter *writer)
+{
+  struct stat ours, named;
+  gboolean res;
+  int fd;
+
+  fd = shm_open (writer->name, O_RDONLY, 0);
+  if (fd == -1)
+    return FALSE;
+
+  res = fstat (writer->fd, &ours) == 0 && fstat (fd, &named) == 0 &&
+      ours.st_dev == named.st_dev && ours.st_ino == named.st_ino;
+  close (fd);
+
+  return res;
+}
+
+/* tells readers to go look for a new segment */
+static void
+writer_close (GstRTSPCamShmWriter *writer)
+{
+  if (writer->map == NULL)
+    return;
+
+  g_atomic_int_set (&writer->header->closed, 1);
+  munmap (writer->map, writer->map_size);
+  if (writer_owns_name (writer))
+    shm_unlink (writer->name);
+  close (writer->fd);
+
+  writer->map = NULL;
+  writer->header = NULL;
+  writer->fd = -1;
+}
+
+static void
+writer_update_caps (GstRTSPCamShmWriter *writer, GstCaps *caps)
+{
+  GstStructure *structure;
+  gchar *caps_string;
+
+  gst_caps_replace (&writer->caps, caps);
+
+  writer->width = writer->height = 0;
+  writer->caps_string[0] = '\0';
+  if (caps == NULL)
+    return;
+
+  structure = gst_caps_get_structure (caps, 0);
+  gst_structure_get_int (structure, "width", &writer->width);
+  gst_structure_get_int (structure, "height", &writer->height);
+
+  caps_string = gst_caps_to_string (caps);
+  g_strlcpy (writer->caps_string, caps_string, GST_RTSP_CAM_SHM_CAPS_LEN);
+  g_free (caps_string);
+}
+
+static gboolean
+writer_write (GstRTSPCamShmWriter *writer, GstBuffer *buffer)
+{
+  GstRTSPCamShmSlot *slot;
+  guint32 number;
+  GstClockTime now;
+
+  /* caps were renegotiated to bigger frames */
+  if (writer->header != NULL &&
+      GST_BUFFER_SIZE (buffer) > writer->header->slot_size) {
+    GST_INFO ("frames grew to %u bytes, recreating %s",
+        GST_BUFFER_SIZE (buffer), writer->name);
+    writer_close (writer);
+  }
+
+  if (writer->header == NULL) {
+    /* failures like a full /dev/shm can go away, keep trying but back off so
+     * we don't retry on every frame */
+    now = gst_util_get_timestamp ();
+    if (now < writer->retry_at)
+      return FALSE;
+
+    if (!writer_open (writer, GST_BUFFER_SIZE (buffer))) {
+      writer->retry_delay = CLAMP (writer->retry_delay * 2,
+          MIN_RETRY_DELAY, MAX_RETRY_DELAY);
+      writer->retry_at = now + writer->retry_delay;
+      GST_WARNING ("retrying %s in %" GST_TIME_FORMAT, writer->name,
+          GST_TIME_ARGS (writer->retry_delay));
+
+      return FALSE;
+    }
+
+    writer->retry_delay = 0;
+    writer->retry_at = 0;
+  }
+
+  if (GST_BUFFER_CAPS (buffer) != writer->caps)
+    writer_update_caps (writer, GST_BUFFER_CAPS (buffer));
+
+  number = writer->header->sequence;
+  slot = get_slot (writer->header, number);
+
+  /* lock only changes parity when wrapping, since 2^32 is even */
+  COUNTER_SET (slot->lock, slot->lock + 1);
+  slot->number = number;
+  slot->size = GST_BUFFER_SIZE (buffer);
+  slot->width = writer->width;
+  slot->height = writer->height;
+  slot->timestamp = GST_BUFFER_TIMESTAMP (buffer);
+  slot->duration = GST_BUFFER_DURATION (buffer);
+  memcpy (slot->caps, writer->caps_string, GST_RTSP_CAM_SHM_CAPS_LEN);
+  memcpy ((guint8 *) slot + sizeof (GstRTSPCamShmSlot),
+      GST_BUFFER_DATA (buffer), GST_BUFFER_SIZE (buffer));
+  COUNTER_SET (slot->lock, slot->lock + 1);
+
+  COUNTER_SET (writer->header->sequence, number + 1);
+
+  return TRUE;
+}
+
+/* never blocks on readers: readers that can't keep up just find newer
+ * frames. The writer can be shared by several pipelines, their writes are
+ * serialized. */
+gboolean
+gst_rtsp_cam_shm_writer_write (GstRTSPCamShmWriter *writer, GstBuffer *buffer)
+{
+  gboolean res;
+
+  g_mutex_lock (writer->lock);
+  res = writer_write (writer, buffer);
+  g_mutex_unlock (writer->lock);
+
+  return res;
+}
+
+void
+gst_rtsp_cam_shm_writer_free (GstRTSPCamShmWriter *writer)
+{
+  writer_close (writer);
+
+  gst_caps_replace (&writer->caps, NULL);
+  g_mutex_free (writer->lock);
+  g_free (writer->name);
+  g_free (writer);
+}
+
+GstRTSPCamShmReader *
+gst_rtsp_cam_shm_reader_new (const gchar *name)
+{
+  GstRTSPCamShmReader *reader;
+  GstRTSPCamShmHeader *header;
+  struct stat st;
+
+  g_return_val_if_fail (name != NULL, NULL);
+
+  reader = g_new0 (GstRTSPCamShmReader, 1);
+
+  reader->fd = shm_open (name, O_RDONLY, 0);
+  if (reader->fd == -1)
+    goto error;
+
+  if (fstat (reader->fd, &st) == -1 ||
+      st.st_size < sizeof (GstRTSPCamShmHeader))
+    goto error;
+
+  reader->map_size = st.st_size;
+  reader->map = mmap (NULL, reader->map_size, PROT_READ, MAP_SHARED,
+      reader->fd, 0);
+  if (reader->map == MAP_FAILED) {
+    reader->map = NULL;
+    goto error;
+  }
+
+  header = (GstRTSPCamShmHeader *) reader->map;
+  if (g_atomic_int_get ((gint *) &header->magic) != GST_RTSP_CAM_SHM_MAGIC ||
+      header->version != GST_RTSP_CAM_SHM_VERSION ||
+      header->n_slots == 0 ||
+      (header->n_slots & (header->n_slots - 1)) != 0 ||
+      get_map_size (header->n_slots, header->slot_stride) > reader->map_size)
+    goto error;
+  reader->header = header;
+
+  return reader;
+
+error:
+  gst_rtsp_cam_shm_reader_free (reader);
+
+  return NULL;
+}
+
+/* Returns the most recent frame if it's newer than the last one returned,
+ * skipping whatever was written in between. frame->data points straight into
+ * the shared memory, call gst_rtsp_cam_shm_reader_frame_valid () once done
+ * with it to know whether the writer has overwritten it in the meantime.
+ * Returns GST_RTSP_CAM_SHM_CLOSED once the writer is gone, at which point the
+ * reader should be freed and the name opened again.
+ */
+GstRTSPCamShmReturn
+gst_rtsp_cam_shm_reader_next (GstRTSPCamShmReader *reader,
+    GstRTSPCamShmFrame *frame)
+{
+  GstRTSPCamShmSlot *slot;
+  guint32 number;
+
+  if (g_atomic_int_get (&reader->header->closed))
+    return GST_RTSP_CAM_SHM_CLOSED;
+
+  number = COUNTER_GET (reader->header->sequence) - 1;
+  if (reader->have_last && number == reader->last)
+    return GST_RTSP_CAM_SHM_NO_FRAME;
+
+  /* sequence is also 0 after wrapping, a slot that was never written is what
+   * tells that there's no frame yet */
+  slot = get_slot (reader->header, number);
+  frame->lock = COUNTER_GET (slot->lock);
+  if (frame->lock == 0 || (frame->lock & 1))
+    return GST_RTSP_CAM_SHM_NO_FRAME;
+
+  frame->slot = slot;
+  frame->number = slot->number;
+  frame->size = MIN (slot->size, reader->header->slot_size);
+  frame->width = slot->width;
+  frame->height = slot->height;
+  frame->timestamp = slot->timestamp;
+  frame->duration = slot->duration;
+  memcpy (frame->caps, slot->caps, GST_RTSP_CAM_SHM_CAPS_LEN);
+  frame->caps[GST_RTSP_CAM_SHM_CAPS_LEN - 1] = '\0';
+  frame->data = (const guint8 *) slot + sizeof (GstRTSPCamShmSlot);
+
+  if (!gst_rtsp_cam_shm_reader_frame_valid (reader, frame) ||
+      frame->number != number)
+    return GST_RTSP_CAM_SHM_NO_FRAME;
+
+  frame->skipped = reader->have_last ? number - reader->last - 1 : 0;
+  reader->last = number;
+  reader->have_last = TRUE;
+
+  return GST_RTSP_CAM_SHM_OK;
+}
+
+gboolean
+gst_rtsp_cam_shm_reader_frame_valid (GstRTSPCamShmReader *reader,
+    GstRTSPCamShmFrame *frame)
+{
+  return COUNTER_GET (frame->slot->lock) == frame->lock;
+}
+
+void
+gst_rtsp_cam_shm_reader_free (GstRTSPCamShmReader *reader)
+{
+  if (reader->map)
+    munmap (reader->map, reader->map_size);
+  if (reader->fd != -1)
+    close (reader->fd);
+
+  g_free (reader);
+}
@@ -0,0 +1,111 @@
+/* GStreamer
+ * Copyright (C) 2010 Alessandro Decina <alessandro.d@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <gst/gst.h>
+
+#ifndef __GST_RTSP_CAM_SHM_H__
+#define __GST_RTSP_CAM_SHM_H__
+
+G_BEGIN_DECLS
+
+/* Raw frames are exported in a POSIX shared memory segment laid out as a
+ * GstRTSPCamShmHeader followed by n_slots slots. Each slot is a
+ * GstRTSPCamShmSlot followed by slot_size bytes of frame data, and slots are
+ * slot_stride bytes apart. n_slots is always a power of two.
+ *
+ * There is a single writer, which never waits for readers. Frame n is written
+ * in slot n % n_slots and header->sequence is bumped to n + 1 once it's
+ * complete. slot->lock is odd while the writer is filling the slot, so a
+ * reader can detect that a frame it's looking at has been overwritten.
+ * Frame numbers, sequence and lock are unsigned 32 bit counters that wrap
+ * around: since n_slots divides 2^32, frame n stays in slot n % n_slots across
+ * the wrap, and differences between frame numbers are taken modulo 2^32.
+ *
+ * The writer never resizes a segment readers might have mapped. When it goes
+ * away or needs bigger slots, it sets header->closed and unlinks the segment,
+ * and readers are expected to open the name again.
+ */
+
+#define GST_RTSP_CAM_SHM_MAGIC 0x4d414352
+#define GST_RTSP_CAM_SHM_VERSION 2
+#define GST_RTSP_CAM_SHM_CAPS_LEN 256
+
+typedef struct _GstRTSPCamShmHeader GstRTSPCamShmHeader;
+typedef struct _GstRTSPCamShmSlot GstRTSPCamShmSlot;
+typedef struct _GstRTSPCamShmFrame GstRTSPCamShmFrame;
+typedef struct _GstRTSPCamShmWriter GstRTSPCamShmWriter;
+typedef struct _GstRTSPCamShmReader GstRTSPCamShmReader;
+
+typedef enum {
+  GST_RTSP_CAM_SHM_OK,
+  GST_RTSP_CAM_SHM_NO_FRAME,
+  GST_RTSP_CAM_SHM_CLOSED
+} GstRTSPCamShmReturn;
+
+struct _GstRTSPCamShmHeader {
+  guint32 magic;
+  guint32 version;
+  guint32 n_slots;
+  guint32 slot_size;
+  guint32 slot_stride;
+  volatile guint32 sequence;
+  volatile gint closed;
+};
+
+struct _GstRTSPCamShmSlot {
+  volatile guint32 lock;
+  guint32 number;
+  guint32 size;
+  gint width;
+  gint height;
+  guint64 timestamp;
+  guint64 duration;
+  gchar caps[GST_RTSP_CAM_SHM_CAPS_LEN];
+};
+
+struct _GstRTSPCamShmFrame {
+  const guint8 *data;
+  gsize size;
+  guint32 number;
+  guint32 skipped;
+  gint width;
+  gint height;
+  GstClockTime timestamp;
+  GstClockTime duration;
+  gchar caps[GST_RTSP_CAM_SHM_CAPS_LEN];
+
+  /*< private >*/
+  GstRTSPCamShmSlot *slot;
+  guint32 lock;
+};
+
+GstRTSPCamShmWriter * gst_rtsp_cam_shm_writer_new (const gchar *name, guint n_slots);
+gboolean gst_rtsp_cam_shm_writer_write (GstRTSPCamShmWriter *writer, GstBuffer *buffer);
+void gst_rtsp_cam_shm_writer_free (GstRTSPCamShmWriter *writer);
+
+GstRTSPCamShmReader * gst_rtsp_cam_shm_reader_new (const gchar *name);
+GstRTSPCamShmReturn gst_rtsp_cam_shm_reader_next (GstRTSPCamShmReader *reader,
+    GstRTSPCamShmFrame *frame);
+gboolean gst_rtsp_cam_shm_reader_frame_valid (GstRTSPCamShmReader *reader,
+    GstRTSPCamShmFrame *frame);
+void gst_rtsp_cam_shm_reader_free (GstRTSPCamShmReader *reader);
+
+G_END_DECLS
+
+#endif /* __GST_RTSP_CAM_SHM_H__ */
@@ -28,15 +28,21 @@ timeout (GstRTSPServer *server, gboolean ignored)
 static char *video_device = NULL;
 static char *video_codec = NULL;
 static char *video_codec_options = NULL;
+static gboolean video_codec_autotune = FALSE;
+static int video_codec_headroom = 20;
 static int video_width = -1;
 static int video_height = -1;
 static int fps_n = 0;
 static int fps_d = 1;
+static char *video_export = NULL;
+static int video_export_slots = 4;
 static char *audio_device = NULL;
 static char *audio_codec = NULL;
 static char *audio_codec_options = NULL;
 static gboolean no_audio = FALSE;
 static gboolean no_video = FALSE;
+static char *mosaic_devices = NULL;
+static int mosaic_columns = 0;
 
 static const GOptionEntry option_entries[] = {
   {"video-device", 0, 0, G_OPTION_ARG_STRING, &video_device,
@@ -45,6 +51,10 @@ static const GOptionEntry option_entries[] = {
       "The video codec", NULL},
   {"video-codec-options", 0, 0, G_OPTION_ARG_STRING, &video_codec_options,
       "The video codec options", NULL},
+  {"video-codec-autotune", 0, 0, G_OPTION_ARG_NONE, &video_codec_autotune,
+      "Pick the video codec preset that sustains the framerate", NULL},
+  {"video-codec-headroom", 0, 0, G_OPTION_ARG_INT, &video_codec_headroom,
+      "The percentage of CPU time autotune keeps free", NULL},
   {"video-width", 0, 0, G_OPTION_ARG_INT, &video_width,
       "The video width", NULL},
   {"video-height", 0, 0, G_OPTION_ARG_INT, &video_height,
@@ -53,6 +63,11 @@ static const GOptionEntry option_entries[] = {
       "The video framerate numerator", NULL},
   {"video-fps-d", 0, 0, G_OPTION_ARG_INT, &fps_d,
       "The video framerate denominator", NULL},
+  {"video-export", 0, 0, G_OPTION_ARG_STRING, &video_export,
+      "Export raw video frames to the named shared memory, keeping the "
+      "camera running even with no clients", NULL},
+  {"video-export-slots", 0, 0, G_OPTION_ARG_INT, &video_export_slots,
+      "The number of frames kept in the shared memory export", NULL},
   {"audio-device", 0, 0, G_OPTION_ARG_STRING, &audio_device,
       "The audio height", NULL},
   {"audio-codec", 0, 0, G_OPTION_ARG_STRING, &audio_codec,
@@ -63,6 +78,12 @@ static const GOptionEntry option_entries[] = {
       "Don't stream audio", NULL},
   {"no-video", 0, 0, G_OPTION_ARG_NONE, &no_video,
       "Don't stream video", NULL},
+  {"mosaic-devices", 0, 0, G_OPTION_ARG_STRING, &mosaic_devices,
+      "Comma separated video devices or URIs to composite in a single grid. "
+      "Use the rtsp:// mounts of cameras already served by gst-rtsp-cam, "
+      "since their devices can't be opened twice", NULL},
+  {"mosaic-columns", 0, 0, G_OPTION_ARG_INT, &mosaic_columns,
+      "The number of mosaic columns", NULL},
   {NULL}
 };
 
@@ -107,6 +128,13 @@ main(int argc, char **argv)
     return 1;
   }
 
+  if (video_device && mosaic_devices) {
+    g_printerr ("--video-device can't be used with --mosaic-devices, "
+        "add the device to the mosaic instead\n");
+
+    return 1;
+  }
+
   if (gst_rtsp_url_parse (argv[1], &local_url) != GST_RTSP_OK) {
     g_printerr ("invalid rtsp url\n");
 
@@ -130,27 +158,59 @@ main(int argc, char **argv)
       "video-height", video_height,
       "video-codec", video_codec,
       "video-codec-options", video_codec_options,
+      "video-codec-autotune", video_codec_autotune,
+      "video-codec-headroom", video_codec_headroom,
       "video-framerate", fps_n, fps_d,
+      "video-export", video_export,
+      "video-export-slots", video_export_slots,
       "audio", !no_audio,
       "audio-device", audio_device,
       "audio-codec", audio_codec,
       "audio-codec-options", audio_codec_options,
+      "mosaic-devices", mosaic_devices,
+      "mosaic-columns", mosaic_columns,
       NULL);
 
   g_printerr ("video-codec-options: %s\n", video_codec_options);
   g_printerr ("audio-codec-options: %s\n", audio_codec_options);
 
+  if (video_codec_autotune && !no_video) {
+    gint width, height, assumed_fps_n, assumed_fps_d;
+
+    if (!gst_rtsp_cam_media_factory_get_video_format (factory,
+            &width, &height, &assumed_fps_n, &assumed_fps_d))
+      g_printerr ("video size or framerate not set, autotune assumes "
+          "%dx%d at %d/%d fps\n", width, height, assumed_fps_n, assumed_fps_d);
+
+    switch (gst_rtsp_cam_media_factory_calibrate (factory)) {
+      case GST_RTSP_CAM_CALIBRATION_OK:
+        break;
+      case GST_RTSP_CAM_CALIBRATION_OVERLOADED:
+        g_printerr ("video codec can't sustain the framerate\n");
+        break;
+      case GST_RTSP_CAM_CALIBRATION_ERROR:
+        g_printerr ("couldn't calibrate the video codec, see the "
+            "rtspcammediafactory debug log\n");
+        break;
+    }
+  }
+
   gst_rtsp_media_factory_set_shared (GST_RTSP_MEDIA_FACTORY (factory), TRUE);
   mapping = gst_rtsp_server_get_media_mapping (server);
   gst_rtsp_media_mapping_add_factory (mapping, local_url->abspath,
       GST_RTSP_MEDIA_FACTORY (factory));
   g_object_unref (mapping);
 
+  if (video_export && !no_video &&
+      !gst_rtsp_cam_media_factory_keep_alive (factory, local_url))
+    g_printerr ("couldn't start the video export, retrying\n");
+
   gst_rtsp_url_free (local_url);
 
   gst_rtsp_server_attach (server, NULL);
 
   g_timeout_add_seconds (10, (GSourceFunc) timeout, server); 
+
   /* start serving */
   g_main_loop_run (loop);
 